@@ -1,31 +1,67 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
 #include "db.h"
+#include "page.h"
+#include "zcache.h"
 // define if debug output wanted
 //#define DEBUGBUF
 
 // declarations for buffer pool hash table
-struct hashBucket
+struct hashEntry
 {
-	File*	file;    // pointer a file object (more on this below)
+	const File*	file;    // pointer a file object, NULL if slot is empty
 	int	pageNo;  // page number within a file
 	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
 };
 
 
-// hash table to keep track of pages in the buffer pool
+// hash table to keep track of pages in the buffer pool.
+//
+// The table is split into NUMPARTS partitions, each an open-addressing
+// array with linear probing.  All slots are allocated by the constructor,
+// sized from the number of frames, so insert and remove never touch the
+// heap.  The high bits of the hash select the partition and the low bits
+// the home slot within it.
+//
+// Each partition is protected by its own latch.  The table itself does
+// no locking: callers acquire latch(file, pageNo) around insert/lookup/
+// remove and around any change to the frame that entry refers to.
 class BufHashTbl
 {
 private:
-    int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    struct Partition {
+      std::mutex latch;	// protects the slots of this partition
+      int	 used;	// number of occupied slots
+    } __attribute__((aligned(64)));
+
+    int PARTSIZE;		// slots per partition, a power of 2
+    hashEntry*  ht;		// actual hash table, NUMPARTS * PARTSIZE slots
+    Partition*  parts;		// one per partition
+
+    // mixes (file,pageNo) into a 64-bit hash value
+    static unsigned long long hash(const File* file, const int pageNo);
+    int partition(unsigned long long h) const
+    {
+      return (int)(h >> 32) & (NUMPARTS - 1);
+    }
 
 public:
-    BufHashTbl(const int htSize);  // constructor
+    static const int NUMPARTS = 16;   // number of latch partitions
+
+    BufHashTbl(const int numBufs);  // constructor
     ~BufHashTbl(); // destructor
+
+    // returns the latch of the partition that (file,pageNo) hashes to
+    std::mutex& latch(const File* file, const int pageNo)
+    {
+      return parts[partition(hash(file, pageNo))].latch;
+    }
 	
     // insert entry into hash table mapping (file,pageNo) to frameNo;
     // returns 0 if OK, HASHTBLERROR if an error occurred
@@ -44,24 +80,63 @@ public:
 
 class BufMgr;  //forward declaration of BufMgr class 
 
-// class for maintaining information about buffer pool frames
+
+// replacement policies selectable when the BufMgr is constructed
+enum ReplPolicy { REPL_CLOCK, REPL_2Q, REPL_ARC };
+
+// how the buffer pool arena may be backed, or'ed together; BufMgr falls
+// back to ordinary pages when the system has no huge pages to give
+enum PoolFlags {
+  POOL_HUGETLB = 1,		// mmap(MAP_HUGETLB) from the reserved huge pages
+  POOL_THP = 2			// 2 MB aligned, madvise(MADV_HUGEPAGE)
+};
+
+// per-frame bookkeeping of the list-based replacement policies
+struct ReplMeta {
+  int	prev;	// neighbours on the policy's frame list, -1 at the ends
+  int	next;
+  int	list;	// list the frame is on, -1 while taken off by victim()
+  int	origin;	// list the frame was last on
+};
+
+// class for maintaining information about buffer pool frames.
+//
+// The identity of a frame (file, pageNo, valid) only changes while the
+// latch of the partition that identity hashes to is held, or while the
+// frame is claimed (pinned with valid == false) by a single thread.
+// pinCnt, refbit and the identity fields are atomic so that the clock
+// sweep can inspect frames without taking any latch.
 class BufDesc {
     friend class BufMgr;
+    friend class ClockReplacer;
+    friend class TwoQReplacer;
+    friend class ArcReplacer;
+    friend struct FrameList;
 private:
-  File* file;   // pointer to file object
-  int   pageNo; // page within file
+  std::atomic<File*> file;   // pointer to file object
+  std::atomic<int>   pageNo; // page within file
   int	frameNo;  // frame # of frame
-  int   pinCnt; // number of times this page has been pinned
-  bool 	dirty;	  // true if dirty;  false otherwise
-  bool 	valid;   // true if page is valid
-  bool  refbit;	 // has this buffer frame been reference recently
+  std::atomic<int>   pinCnt; // number of times this page has been pinned
+  bool 	dirty;	  // true if dirty;  false otherwise (under partition latch)
+  std::atomic<unsigned> changes; // times unpinned dirty, so a write-back
+			  // can tell whether the page changed meanwhile
+  std::atomic<bool>  valid;   // true if page is valid
+  std::atomic<bool>  refbit;	 // has this buffer frame been reference recently
+  std::atomic<bool>  ioInProgress; // page is still being read from disk
+  std::atomic<bool>  prefetched; // read ahead and not pinned since
+  std::atomic<bool>  writeBack; // pinned by cleanFrame() while written
+  ReplMeta	repl;	 // replacement policy state, under the policy's latch
 
   void Clear() {  // initialize buffer frame for a new user
-    	pinCnt = 0;
 	file = NULL;
 	pageNo = -1;
     	dirty = false;
+	changes = 0;
 	valid = false;
+	ioInProgress = false;
+	prefetched = false;
+	writeBack = false;
+    	pinCnt = 0;	// last, so the frame is only reusable once cleared
   };
 
   void Set(File* filePtr, int pageNum) { 
@@ -69,65 +144,232 @@ private:
       pageNo = pageNum;
       pinCnt = 1;
       dirty = false;
-      valid = true;
       refbit = true;
+      ioInProgress = false;
+      prefetched = false;
+      valid = true;
   }
 
   BufDesc() {
+      frameNo = -1;
+      refbit = false;
       Clear();
   }
 };
 
 
+// Interface of a buffer replacement policy.  BufMgr asks the policy for
+// victims and reports every load, re-pin, eviction and release of a
+// frame to it.  Policies never take a partition latch, so these hooks
+// may be called while one is held.
+class BufReplacer
+{
+public:
+  virtual ~BufReplacer() {}
+
+  virtual const char* name() const = 0;
+
+  // Returns a frame to reuse for (file,pageNo): an invalid frame or an
+  // unpinned one, or -1 if there is none.  The frame is taken off the
+  // policy's lists until evicted(), restore() or freed() is called.
+  virtual int victim(const File* file, const int pageNo) = 0;
+
+  // the victim could not be claimed after all (it was pinned meanwhile)
+  virtual void restore(const int frame) = 0;
+
+  // the victim held (file,pageNo) and has been evicted
+  virtual void evicted(const int frame, const File* file, const int pageNo) = 0;
+
+  // frame now holds (file,pageNo), read in or newly allocated
+  virtual void loaded(const int frame, const File* file, const int pageNo) = 0;
+
+  // a resident page was pinned again
+  virtual void pinned(const int frame) = 0;
+
+  // frame was invalidated (flushFile, disposePage) or not used after
+  // all, and is free again
+  virtual void freed(const int frame) = 0;
+
+  // frame at which the page cleaner should start its pass
+  virtual int cleanerStart() = 0;
+
+  static BufReplacer* create(const ReplPolicy policy, BufDesc* bufTable,
+			     const int numBufs);
+};
+
+
+// Pool-wide counters; the same broken down by file are in each File's
+// FileStats.
+
 struct BufStats
 {
-  int accesses;    // Total number of accesses to buffer pool
-  int diskreads;   // Number of pages read from disk (including allocs)
-  int diskwrites;  // Number of pages written back to disk
+  Counter accesses;                   // Total number of accesses to buffer pool
+  Counter hits;                       // Accesses that found the page in the pool
+  Counter misses;                     // readPage calls that read the page
+  Counter mapped;                     // readPage calls served from a mapping
+  Counter zcacheHits;                 // misses served by the compressed tier
+  Counter diskreads;                  // Number of pages read from disk (including allocs)
+  Counter diskwrites;                 // Number of dirty pages written back to disk
+  Counter evictions;                  // Valid pages replaced by allocBuf
+  Counter bufferExceeded;             // Calls failed with BUFFEREXCEEDED
+  Counter prefetchIssued;             // Pages read ahead of the caller
+  Counter prefetchHits;               // Read-ahead pages later pinned
+  Counter prefetchWasted;             // Read-ahead pages dropped unused
+  LatencyHistogram missLatency;	      // readPage misses, start to finish
+  CodecStats compression;	      // pages put into and taken from the tier
+  const char* policy;		// name of the replacement policy
 
   void clear()
     {
-      accesses = diskreads = diskwrites = 0;
+      accesses = hits = misses = mapped = zcacheHits = 0;
+      diskreads = diskwrites = 0;
+      evictions = bufferExceeded = 0;
+      prefetchIssued = prefetchHits = prefetchWasted = 0;
+      missLatency.clear();
+      compression.clear();
+    }
+
+  double hitRatio() const
+    {
+      return accesses > 0 ? (double)hits / accesses : 0.0;
     }
       
   BufStats()
     {
+      policy = "";
       clear();
     }
 };
 
 
+// Frames a scan recycles instead of taking new ones from the replacement
+// policy, so that reading a large file through a BufScan only ever
+// displaces as many pages as the ring has frames.  Each entry remembers
+// the page it was filled with; see BufMgr::allocRingBuf().
+struct BufRing
+{
+  std::vector<int>	    frames;  // -1 while not filled yet
+  std::vector<const File*> files;   // page each frame was filled with
+  std::vector<int>	    pageNos;
+  int			    next;    // entry to reuse next
+
+  BufRing(const int size) : frames(size, -1), files(size, NULL),
+			    pageNos(size, -1), next(0) {}
+};
+
+
+// The buffer manager may be shared by several threads.  readPage,
+// unPinPage, allocPage and disposePage only serialize on the latch of
+// the partition the page hashes to; with the clock policy a miss
+// sweeps for a victim without blocking hits on other pages.
 class BufMgr 
 {
+  friend class BufScan;
 private:
-  unsigned int 	 clockHand;
   int   	 numBufs;    	// Number of pages in buffer pool
   BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
+  BufReplacer*   replacer;	// picks the frames to evict
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
   BufStats	 bufStats;	// buffer pool statistics
+  void*		 arena;		// holds bufPool, then bufTable
+  size_t	 arenaSize;
+  int		 poolFlags;	// PoolFlags the arena actually got
+  CompressedCache* zcache;	// evicted pages, NULL if not kept
 
-  const Status allocBuf(int & frame);   // allocate a free frame.  
-  const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
+  AccessTrace*	 trace;		// event ring, NULL until startTrace()
+  std::atomic<bool> tracing;	// record events in trace
+  std::mutex	 traceLatch;	// serializes startTrace and dumpTrace
+
+  void traceEvent(const File* file, const int pageNo,
+		  const TraceEvent event, const int frame)
   {
-	clockHand = (clockHand + 1) % numBufs;
+    if (tracing.load(std::memory_order_acquire))
+      trace->record(file->getId(), pageNo, event, frame);
   }
 
+  std::thread*   cleaner;	// background page cleaner, NULL if not running
+  std::mutex     cleanerLatch;	// protects cleanerStop and the wakeup below
+  std::condition_variable cleanerWakeup;
+  bool		 cleanerStop;
+
+  const Status allocBuf(int & frame,   // allocate a free frame for
+			const File* file, const int pageNo); // (file,pageNo)
+  const void releaseBuf(int frame); // return unused frame to end of list
+  const Status waitForIo(int frame); // wait until a pinned frame is read in
+  const Status cleanFrame(int frame, bool& wrote); // write back if dirty and unpinned
+  void waitForWriteBack(const int frame); // until cleanFrame() is done with it
+  void discardPage(const File* file, const int pageNo); // drop, unwritten
+  const Status writeFrames(const int frames[], const int count); // batched write-back
+  const Status pinNewPage(File* file, const int pageNo, Page*& page); // frame for a new page
+  const Status fetchPage(File* file, const int pageNo, Page*& page,
+			 BufRing* ring);	// readPage, miss from ring
+  const Status allocRingBuf(BufRing& ring, int& frame,
+			    const File* file, const int pageNo);
+  bool reclaimFrame(const int frame, const File* file, const int pageNo);
+  bool pinResident(const int frame);	// pin a frame found in the hash table
+  void dropFrame(const int frame);	// invalidate an unpinned resident frame
+
+  // sequential read-ahead, see readAhead() in buf.C
+  static const int RAINIT = 4;	// first window, in pages
+  static const int RAMAX = 32;	// largest window, in pages
+  void readAhead(File* file, const int pageNo, const bool prefetchHit);
+  void prefetch(File* file, const int first, int count, BufRing* ring);
+  const Status startPrefetch(File* file, const int pageNo, int& frame,
+			     BufRing* ring);
+  void finishPrefetch(File* file, const int first, const int count,
+		      const int frames[]);
+  void cleanerLoop(const int intervalMs, const int maxWrites);
+
 
 public:
   Page*	         bufPool;   // actual buffer pool
 
-  BufMgr(const int bufs);
+  // zcacheBytes, if not 0, is the memory for a compressed tier of
+  // evicted pages, see CompressedCache in zcache.h
+  BufMgr(const int bufs, const ReplPolicy policy = REPL_CLOCK,
+	 const int flags = 0, const size_t zcacheBytes = 0);
   ~BufMgr();
 
   const Status readPage(File* file, const int PageNo, Page*& page);
   const Status unPinPage(File* file, const int PageNo, const bool dirty);
+			// a page used in place from a read-only mapping
+			// cannot be dirty: PAGEREADONLY, still pinned
   const Status allocPage(File* file, int& PageNo, Page*& page); 
                         // allocates a new, empty page 
+  const Status allocPages(File* file, const int count, int pageNos[],
+			  Page* pages[]); // allocates count new, empty pages
+  const Status allocSpace(File* file, const int bytes, int& pageNo,
+			  Page*& page); // pins a page with bytes free for records
   const Status flushFile(const File* file); // writing out all dirty pages of the file
+  void  forgetFile(const File* file); // write back what is unpinned, drop
+				      // all its frames, for a forced close
   const Status disposePage(File* file, const int PageNo); // dispose of page in file
+
+  // Background write-back: every intervalMs the cleaner walks the pool
+  // starting just ahead of the next victims and writes back up to maxWrites dirty,
+  // unpinned frames, so that allocBuf rarely has to write a victim itself.
+  const Status startCleaner(const int intervalMs = 10, const int maxWrites = 32);
+  void  stopCleaner();
+
+  // Optional trace of hits, misses, allocations, evictions and dirty
+  // unpins for offline cache simulation; see AccessTrace in stats.h.
+  // The oldest events are lost once capacity have been recorded.
+  void  startTrace(const int capacity = 1 << 20);
+  void  stopTrace();
+  const Status dumpTrace(const char* path);
+  long long traceLost() const;	// events overwritten so far
+
   void  printSelf();
+  void  printStats(ostream& os) const; // counters and miss latencies
 
+  const int getPoolFlags() const // PoolFlags in effect for the pool
+  {
+	return poolFlags;
+  }
+  const CompressedCache* getCompressedCache() const // NULL if none
+  {
+	return zcache;
+  }
   const BufStats & getBufStats() const // get buffer pool usage
   {
 	return bufStats;
@@ -138,5 +380,55 @@ public:
   }
 };
 
+
+
+// A record handed out by BufScan, in place in its buffer pool frame.
+struct RecordView
+{
+  RID		rid;
+  const char*	data;
+  int		length;
+};
+
+// Scan of the records of a file, following the page chain (nextPage)
+// from File::getFirstPage().  next() returns the records in batches of
+// views into the pinned frames, without copying; they stay valid until
+// the following call to next().  At most window pages are pinned at a
+// time, and where the chain runs through consecutive page numbers the
+// next window of pages is read ahead with one batch.  Pages that miss
+// are read into a ring of ringSize frames (see BufRing), so the scan
+// does not flush the rest of the pool.
+class BufScan
+{
+public:
+  static const int WINDOW = 8;		// default pages pinned at once
+  static const int RING = 32;		// default frames in the ring
+
+  BufScan(BufMgr* mgr, File* file, const int window = WINDOW,
+	  const int ringSize = RING);
+  ~BufScan();				// endScan()
+
+  // Fills views[0..count) with the next records, max at most.  Returns
+  // FILEEOF (with count 0) once all records have been returned.
+  const Status next(RecordView views[], const int max, int& count);
+
+  // unpins the pages still pinned; the views become invalid
+  const Status endScan();
+
+private:
+  BufMgr*	mgr;
+  File*		file;
+  BufRing	ring;
+  int		window;		// most pages pinned at once
+  std::vector<int> pinned;	// pinned pages, the current one last
+  Page*		curPage;	// last of pinned, NULL before the start
+  RID		curRid;		// last record returned from curPage
+  bool		haveRid;	// curRid is a record of curPage
+  bool		atEnd;		// no pages left in the chain
+  int		raNext;		// first page not read ahead yet
+
+  const Status pinPage(const int pageNo);
+};
+
 #endif
 
@@ -3,8 +3,14 @@
 
 #include <sys/types.h>
 #include <functional>
+#include <mutex>
 #include "error.h"
+#include "io.h"
+#include "stats.h"
+#include "fsm.h"
 #include <string.h>
+#include <vector>
+#include <map>
 using namespace std;
 
 // define if debug output wanted
@@ -15,20 +21,94 @@ using namespace std;
 // forward class definition for db
 class DB;
 
+// flags for DB::openFile
+enum OpenFlags {
+  DB_DIRECTIO = 1,              // bypass the OS cache with O_DIRECT if possible
+  DB_MMAP = 2                   // read pages in place from a mapping, see
+                                // File::enableMap(); overrides DB_DIRECTIO
+};
+
+// flags for DB::createFile
+enum CreateFlags {
+  DB_FSM = 1,                   // keep a free-space map of the file's pages
+  DB_COMPRESS = 2               // store pages compressed, see below
+};
+
+// A file created with DB_FSM tracks the free space of its pages, as
+// Page::getFreeSpace() reports it, so all its pages must be slotted
+// Pages.  The map takes one byte per page and is stored in FSM pages,
+// each covering the PAGESIZE pages of its group: group k is pages
+// [k*PAGESIZE, (k+1)*PAGESIZE), and its FSM page is the group's first
+// page allocated (page 1 for group 0).  The header lists them; pages of
+// groups beyond FSMDIRSIZE are not tracked.
+
+const int FSMDIRSIZE = 240;             // DBPage fits in 1 KB
+
+// A file created with DB_COMPRESS stores every page but the header
+// compressed (see lz.h) in a run of SECTORSIZE-byte sectors, or as it is
+// if it does not shrink by a sector.  The page map says where each page
+// is: a chain of map blocks, each a PAGESIZE run of sectors holding the
+// sector of the next block and then a (sector, length) entry for each
+// of PMAPENTRIES pages.  The first block follows the header; pages with
+// no entry read as zeros.  Runs are reallocated as pages change size,
+// and the map is written back with the header by checkpoint(), so the
+// file is only consistent on disk after that.  Until then the runs
+// pages moved out of are not reused, and the map on disk still finds
+// the pages it had.  Compressed files are never mapped or opened with
+// O_DIRECT.
+
+const int SECTORSIZE = 128;             // unit of space, DB_COMPRESS
+
+// structure of DB (header) page
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list
+  int firstPage;                        // page # of first page in file
+  int numPages;                         // total # of pages in file
+  int pageSize;                         // PAGESIZE of the file, 0 if 1024
+  int fsmCount;                         // # of FSM pages, 0 if no map
+  int fsmPages[FSMDIRSIZE];             // page # of the FSM page of each group
+  int flags;                            // CreateFlags of the file
+  int pmapHead;                         // sector of the first map block,
+                                        // DB_COMPRESS
+} DBPage;
+
 // class definition for open files
 class File {
   friend class DB;
   friend class OpenFileHashTbl;
+  friend class BufMgr;
+  friend class BufScan;
 
  public:
 
   Status allocatePage(int& pageNo);     // allocate a new page
+  const Status allocatePages(const int count,
+		   int pageNos[]);            // allocate count new pages
   const Status disposePage(const int pageNo);       // release space for a page
+  const Status releasePages(const int count,
+		   const int pageNos[]);      // undo allocatePages()
   const Status readPage(const int pageNo,
 		  Page* pagePtr) const;       // read page from file
   const Status writePage(const int pageNo,
 		   const Page* pagePtr);      // write page to file
+  const Status readPages(const int pageNo, const int count,
+		   Page* pages[], int& nread) const; // read consecutive pages
+  const Status readPages(PageIo reqs[],
+		   const int count) const;    // read a batch of pages
+  const Status writePages(PageIo reqs[],
+		   const int count);          // write a batch of pages
   const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  bool hasFsm() const { return withFsm; } // created with DB_FSM
+  const Status findFreePage(const int bytes,
+		   int& pageNo);              // a page with bytes free space
+  const Status checkpoint();            // write back the header page
+  bool directIo() const { return direct; } // opened with O_DIRECT
+  bool mapped() const { return mapBase != NULL; } // opened with DB_MMAP
+  bool compressed() const { return withCompress; } // created with DB_COMPRESS
+  int getId() const { return id; }      // small number naming the file in traces
+  const FileStats& getStats() const { return stats; }
+  void clearStats() { stats.clear(); }
 
   bool operator == (const File & other) const
     {
@@ -40,24 +120,110 @@ class File {
   File(const string &fname);                   // initialize
   ~File();                  // deallocate file object
 
-  static const Status create(const string &fileName);
+  static const Status create(const string &fileName, const int flags);
   static const Status destroy(const string &fileName);
 
-  const Status open();
-  const Status close();
+  const Status open(const int flags = 0);
+  const Status close(const bool force = false); // force: even if pinned
+  void enableDirect();                  // switch to O_DIRECT if supported
+  void enableMap();                     // map the file if possible
+  void mapTo(int end);                  // map the file up to page end
+  void unmap();
+  Page* pinMapped(const int pageNo);    // pin a mapped page, NULL if not
+  const Status unpinMapped(const int pageNo, const bool dirty);
+  void adviseMapped(const int first, const int count); // MADV_WILLNEED
 
   const Status intread(const int pageNo,
 		 Page* pagePtr) const;        // internal file read
   const Status intwrite(const int pageNo,
 		  const Page* pagePtr);       // internal file write
+  int pagesOnDisk();                   // number of pages in the file
+  const Status loadHeader();            // read header and free list
+  const Status extend(const int count); // make room for count more pages
+  const Status loadFsm();               // read the FSM pages
+  bool isFsmPage(const int pageNo) const; // caller holds fsmLatch
+  void noteFreeSpace(const int pageNo,
+		     const int bytes);        // update the map for pageNo
+  const Status loadPmap();              // read the page map, DB_COMPRESS
+  const Status storePmap();             // write back its changed blocks
+  const Status readPacked(const int pageNo,
+		  Page* pagePtr) const;       // intread of a compressed file
+  const Status writePacked(const int pageNo,
+		   const Page* pagePtr);      // and intwrite
+  const Status freePage(const int pageNo); // onto the free list, caller
+                                        // holds hdrLatch
+  int allocSectors(const int count);    // caller holds pmapLatch
+  void freeSectors(const int first, const int count);
 
 #ifdef DEBUGFREE
   void listFree();                      // list free pages
 #endif
 
   string fileName;                    // The name of the file
+  int id;                             // unique among File objects
+  mutable FileStats stats;            // updated by BufMgr and the I/O below
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  bool direct;                        // unixFile was opened with O_DIRECT
+
+  // Memory mapping of a file opened with DB_MMAP.  MAPRESERVE bytes of
+  // address space are reserved at open, and the file is mapped at its
+  // start, read-only, and extended in place as the file grows, so a
+  // Page* handed out stays valid until close.  Pages past the
+  // reservation are read into frames as usual.
+  static const long long MAPRESERVE = 1LL << 36;
+  static const int MAPCHUNK = 4096;   // pin counts per chunk
+  char* mapBase;                      // NULL unless mapped
+  std::atomic<int> mapPages;          // pages mapped from mapBase
+  std::atomic<int>** mapPins;         // pin counts of the mapped pages,
+                                      // chunks allocated as they are mapped
+  std::atomic<long long> mapPinned;   // pins held on mapped pages
+
+  // sequential read-ahead state, maintained by the buffer manager
+  std::mutex raLatch;                 // protects the fields below
+  int raLast;                         // last page read by a miss or prefetch hit
+  int raWindow;                       // read-ahead window in pages, 0 if random
+  int raNext;                         // first page not prefetched yet
+
+  // The header page is cached while the file is open and written back
+  // by checkpoint() and close().  The free list is cached too, its head
+  // at the back; the chain on disk is kept valid, so only the header
+  // is ever stale on disk.
+  static const int EXTENTPAGES = 64;  // file grows in multiples of this
+  mutable std::mutex hdrLatch;        // protects the fields below
+  DBPage hdr;                         // cached header page
+  bool hdrDirty;                      // hdr differs from page 0
+  vector<int> freePages;              // free list, head at the back
+  int extentEnd;                      // pages the unix file has room for
+
+  // The free-space map is cached too and its dirty groups written back
+  // with the header.  It is updated by BufMgr::unPinPage() for every
+  // page unpinned dirty.  Lock order is hdrLatch, then fsmLatch.
+  bool withFsm;                       // set by open(), hdr.fsmCount > 0
+  mutable std::mutex fsmLatch;        // protects the fields below and
+                                      // hdr.fsmCount, hdr.fsmPages
+  FreeSpaceMap fsm;                   // one entry per page of each group
+  vector<bool> fsmDirty;              // FSM page of group k has changed
+
+  // Page map of a compressed file, cached like the header.  Lock order
+  // is hdrLatch, then pmapLatch.  Pages are transferred outside the
+  // latch.  A run a page moved out of stays pending until the map on
+  // disk no longer points to it and no read that may still use it is
+  // in flight; only then can another page take it.
+  struct PageLoc {
+    int sector;                       // first sector of the run
+    int length;                       // bytes stored, 0 if none,
+                                      // PAGESIZE if not compressed
+  };
+  bool withCompress;                  // set by open(), from hdr.flags
+  mutable std::mutex pmapLatch;       // protects the fields below
+  vector<PageLoc> pmap;               // location of each page
+  vector<int> pmapBlocks;             // sector of each map block
+  vector<bool> pmapDirty;             // map block k has changed
+  std::map<int, int> freeRuns;        // free sectors, first -> count
+  vector<std::pair<int, int> > pendingRuns; // freed since storePmap()
+  mutable int packedReads;            // readPacked() calls in flight
+  int sectorEnd;                      // sectors the unix file has
 };
 
 class BufMgr;
@@ -103,10 +269,12 @@ class DB {
   DB();                                 // initialize open file table
   ~DB();                                // clean up any remaining open files
 
-  const Status createFile(const string & fileName) ;  // create a new file
+  const Status createFile(const string & fileName,
+			  const int flags = 0);  // create a new file, see CreateFlags
   const Status destroyFile(const string & fileName) ; // destroy a file, 
                                                            // release all space
-  const Status openFile(const string & fileName, File* & file);  // open a file
+  const Status openFile(const string & fileName, File* & file,
+			const int flags = 0);  // open a file, see OpenFlags
   const Status closeFile(File* file);         // close a file
 
  private:
@@ -114,12 +282,4 @@ class DB {
 };
 
 
-// structure of DB (header) page
-
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
-
 #endif
@@ -0,0 +1,47 @@
+#ifndef FSM_H
+#define FSM_H
+
+#include <vector>
+
+// In-memory free-space map of a file: one byte per page giving the page's
+// free space in steps of PAGESIZE/256 bytes, rounded down, so a page is
+// never reported to have more room than it has.  Above the bytes sits a
+// binary tree holding the maximum of each subtree, as in the FSM pages
+// of PostgreSQL, so finding a page with enough room and changing an
+// entry are both O(log pages).
+//
+// File keeps the bytes on disk in its FSM pages and does the locking;
+// see DB_FSM in db.h.
+
+class FreeSpaceMap
+{
+public:
+  FreeSpaceMap() : leaves(0), leaves0(0) {}
+
+  // track pages [0, pages); entries of new pages are 0
+  void resize(const int pages);
+  int  size() const { return leaves; }
+
+  int  get(const int pageNo) const { return tree[leaves0 + pageNo]; }
+
+  // returns true if the entry changed
+  bool set(const int pageNo, const int category);
+
+  // lowest page whose entry is at least category, -1 if there is none
+  int  find(const int category) const;
+
+  // copy the entries of pages [first, first+count) from/to bytes
+  void load(const int first, const unsigned char* bytes, const int count);
+  void store(const int first, unsigned char* bytes, const int count) const;
+
+private:
+  int leaves;			// pages tracked
+  int leaves0;			// index of page 0's entry, a power of 2
+  std::vector<unsigned char> tree; // tree[1] is the root, tree[i]'s
+				   // children are tree[2i] and tree[2i+1]
+
+  void fix(int node);		// recompute the maxima above node
+  void rebuild(int lo, int hi);	// the same above tree[lo..hi]
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef IO_H
+#define IO_H
+
+#include "error.h"
+
+// Batched page I/O underneath File.
+//
+// A batch is an array of (pageNo, Page*) pairs that are all read or all
+// written.  submit() sorts the batch by page number, transfers every run
+// of adjacent pages with a single vectored call and leaves the outcome of
+// each page in its status field.  Two engines exist: SyncIo issues
+// preadv/pwritev, UringIo queues the runs on an io_uring and waits for
+// them together.  UringIo is only built with -DUSE_IOURING and falls back
+// to SyncIo when the kernel refuses to set up a ring.
+
+class Page;
+
+enum IoOp { IOREAD, IOWRITE };
+
+struct PageIo
+{
+  int	 pageNo;		// page to transfer
+  Page*	 page;			// buffer, sizeof(Page) bytes
+  Status status;		// set by submit(): OK or UNIXERR
+};
+
+class IoEngine
+{
+public:
+  virtual ~IoEngine() {}
+
+  // Transfers every page in reqs[0..count), reordering reqs by page
+  // number.  Returns OK if all pages were transferred, else UNIXERR.
+  virtual const Status submit(const int fd, const IoOp op,
+			      PageIo reqs[], const int count) = 0;
+  virtual const char* name() const = 0;
+
+  static IoEngine* create(const bool uring); // uring if possible, else sync
+  static IoEngine* get();	// engine of the calling thread, all files
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef LZ_H
+#define LZ_H
+
+// Byte-oriented LZ77 codec in the LZ4 block format: each sequence is a
+// token (literal count and match length, a nibble each, extended with
+// 255-bytes where needed), the literals, and a 2-byte offset back to the
+// match.  It is meant for pages: one pass, a small hash table on the
+// stack, no entropy coding, so it runs at memory speed.
+
+// Compress src[0..len) into dst, which has room for cap bytes.  Returns
+// the compressed length, or 0 if that would not be less than cap.
+int lzCompress(const char* src, const int len, char* dst, const int cap);
+
+// Decompress src[0..len) into dst, which has room for cap bytes.  Returns
+// the decompressed length, or -1 if src is not valid compressed data or
+// does not fit.
+int lzDecompress(const char* src, const int len, char* dst, const int cap);
+
+
+class Page;
+struct CodecStats;
+
+// Compress a whole page into dst, which has room for cap bytes, timed
+// and counted in stats.  Returns the compressed length, or 0 if the page
+// does not compress to less than cap.
+int packPage(const Page* page, char* dst, const int cap, CodecStats& stats);
+
+// Decompress src[0..len) into page.  Returns false unless that yields
+// exactly a page.
+bool unpackPage(const char* src, const int len, Page* page, CodecStats& stats);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef PAGE_H
 #define PAGE_H
 
+#include <type_traits>
 #include "error.h"
 #include "string.h"
 
@@ -17,42 +18,68 @@ struct Record
   int length;
 };
 
+// The page size is fixed at build time with -DMINIREL_PAGESIZE=<bytes>,
+// a power of two from 1 KB to 64 KB.  Files remember the size they were
+// created with and cannot be opened by a build with another one.
+
+#ifndef MINIREL_PAGESIZE
+#define MINIREL_PAGESIZE 1024
+#endif
+
+const unsigned PAGESIZE = MINIREL_PAGESIZE;
+static_assert(PAGESIZE >= 1024 && PAGESIZE <= 65536 &&
+	      (PAGESIZE & (PAGESIZE - 1)) == 0,
+	      "MINIREL_PAGESIZE must be a power of two from 1024 to 65536");
+
+// offsets and lengths within a page: short as long as they fit
+typedef std::conditional<PAGESIZE <= 32768, short, int>::type pgoff_t;
+
 // slot structure
 struct slot_t {
-        short	offset;  
-        short	length;  // equals -1 if slot is not in use
+        pgoff_t	offset;  // of the record; of the next free slot if not in use
+        pgoff_t	length;  // equals -1 if slot is not in use
 };
 
-const unsigned PAGESIZE = 1024;
-const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(short)+2*sizeof(int);
+const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(pgoff_t)+2*sizeof(int);
 const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
 // size of the data area of a page
 
 // Class definition for a minirel data page.   
-// The design assumes that records are kept compacted when
-// deletions are performed. Notice, however, that the slot
-// array cannot be compacted.  Notice, this class does not keep
-// the records align, relying instead on upper levels to take
-// care of non-aligned attributes
+// Deleting a record leaves a hole in data[]; holes are squeezed
+// out only when an insert does not fit in the space after freePtr.
+// Slots of deleted records are chained on a free list through
+// their offset field and reused first; slots freed on pages written
+// before there was a list are not on it and stay unused.  Notice,
+// however, that the slot array cannot be compacted.  Notice, this
+// class does not keep the records align, relying instead on upper
+// levels to take care of non-aligned attributes
 
 class Page {
 private:
     char 	data[PAGESIZE - DPFIXED]; 
     slot_t 	slot[1]; // first element of slot array - grows backwards!
-    short	slotCnt; // number of slots in use;
-    short	freePtr; // offset of first free byte in data[]
-    short	freeSpace; // number of bytes free in data[]
-    short	dummy;	// for alignment purposes
+    pgoff_t	slotCnt; // number of slots in use;
+    pgoff_t	freePtr; // offset of first free byte in data[]
+    pgoff_t	freeSpace; // number of bytes free in data[], holes included
+    pgoff_t	freeSlot; // first slot on the free list as its RID slotNo
+			  // plus one, NOFREESLOT if none
     int		nextPage; // forwards pointer
     int		curPage;  // page number of current pointer
 
+    // 0, so that pages written before the free list, whose field was
+    // never set and reads as 0, have none
+    static const pgoff_t NOFREESLOT = 0;
+
+    int contiguousSpace() const; // bytes between freePtr and the slots
+    void compact();              // squeeze the holes out of data[]
+
 public:
     void init(const int pageNo); // initialize a new page
     void dumpPage() const;       // dump contents of a page
 
     const Status getNextPage(int& pageNo) const; // returns value of nextPage
     const Status setNextPage(const int pageNo); // sets value of nextPage to pageNo
-    const short getFreeSpace() const; // returns amount of free space
+    const pgoff_t getFreeSpace() const; // returns amount of free space
 
     // inserts a new record (rec) into the page, returns RID of record 
     const Status insertRecord(const Record & rec, RID& rid);
@@ -60,6 +87,19 @@ public:
     // delete the record with the specified rid
     const Status deleteRecord(const RID & rid);
 
+    // Batch conveniences: plain loops over insertRecord() and
+    // deleteRecord(), no cheaper per record than those.
+
+    // insert recs[0..count) in order until one does not fit; inserted
+    // returns how many did.  Returns NOSPACE if not all of them fit.
+    const Status insertRecords(const Record recs[], const int count,
+			       RID rids[], int& inserted);
+
+    // delete the records with rids[0..count) in order until one is
+    // invalid; deleted returns how many were.
+    const Status deleteRecords(const RID rids[], const int count,
+			       int& deleted);
+
     // returns RID of first record on page
     // returns  NORECORDS if page contains no records.  Otherwise, returns OK
     const Status firstRecord(RID& firstRid) const;
@@ -72,4 +112,6 @@ public:
     const Status getRecord(const RID & rid, Record & rec);
 };
 
+static_assert(sizeof(Page) == PAGESIZE, "Page layout does not fill PAGESIZE");
+
 #endif
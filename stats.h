@@ -0,0 +1,193 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <ostream>
+#include "error.h"
+
+// Instrumentation shared by the buffer manager and the file layer.
+// Everything here is updated with relaxed atomic operations and never
+// takes a latch, so it can stay enabled.
+
+// Current time in nanoseconds, for latency measurements.
+
+long long nowNs();
+
+
+// Event counter bumped by many threads at once.  It is split into
+// SHARDS slots of a cache line each; a thread always adds to the same
+// one, chosen when it first counts, so threads rarely share a line.
+// Reading it sums the slots, so a value read while others count is
+// only approximate.  It reads and is assigned like a long long.
+
+class Counter
+{
+public:
+  static const int SHARDS = 16;
+
+  Counter() { store(0); }
+
+  void operator ++ (int) { add(1); }
+  void operator ++ () { add(1); }
+  void operator += (const long long n) { add(n); }
+  long long operator = (const long long n) { store(n); return n; }
+  operator long long () const { return load(); }
+
+  void add(const long long n)
+    {
+      shards[shard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+  long long load() const
+    {
+      long long sum = 0;
+      for (int i = 0; i < SHARDS; i++)
+	sum += shards[i].value.load(std::memory_order_relaxed);
+      return sum;
+    }
+  void store(const long long n)
+    {
+      shards[0].value.store(n, std::memory_order_relaxed);
+      for (int i = 1; i < SHARDS; i++)
+	shards[i].value.store(0, std::memory_order_relaxed);
+    }
+
+private:
+  struct Shard {
+    std::atomic<long long> value;
+  } __attribute__((aligned(64)));
+  Shard shards[SHARDS];
+
+  Counter(const Counter&) = delete;
+  Counter& operator = (const Counter&) = delete;
+
+  static int shard()
+    {
+      static std::atomic<int> threads(0);
+      static thread_local int mine =
+	threads.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+      return mine;
+    }
+};
+
+
+// Latency histogram in the style of HdrHistogram: values below 8 get a
+// bucket each, larger ones are grouped by their power of two, split into
+// 8 sub-buckets.  Every value is thus kept to within 12.5%, from 1 ns to
+// the range of a long long, in a fixed 4 KB of counters.
+
+class LatencyHistogram
+{
+public:
+  static const int SUBBITS = 3;
+  static const int SUBBUCKETS = 1 << SUBBITS;
+  static const int BUCKETS = (64 - SUBBITS + 1) * SUBBUCKETS;
+
+  LatencyHistogram() { clear(); }
+
+  void record(const long long ns);
+  void clear();
+
+  long long count() const { return total.load(std::memory_order_relaxed); }
+  long long max() const { return maxValue.load(std::memory_order_relaxed); }
+  double mean() const;
+  long long percentile(const double p) const; // lowest value of its bucket
+
+  // one line: count, mean and the 50th, 99th, 99.9th percentile and max
+  void print(std::ostream& os, const char* name) const;
+
+private:
+  std::atomic<long long> counts[BUCKETS];
+  std::atomic<long long> total;
+  std::atomic<long long> sum;
+  std::atomic<long long> maxValue;
+
+  static int bucket(const unsigned long long value);
+  static long long lowest(const int bucket);
+};
+
+
+// Work of the page codec (lz.h): how well pages compress and what that
+// costs.  Pages that would not shrink are counted apart and stored as
+// they are, or not at all.
+
+struct CodecStats
+{
+  Counter packed;                       // pages compressed
+  Counter rawBytes;                     // their size before
+  Counter packedBytes;                  // and after compression
+  Counter incompressible;               // pages that did not shrink
+  Counter unpacked;                     // pages decompressed
+  Counter compressNs;                   // time compressing, all pages tried
+  Counter decompressNs;                 // time decompressing
+
+  CodecStats() { clear(); }
+  void clear();
+  double ratio() const
+    {
+      return packedBytes > 0 ? (double)rawBytes / packedBytes : 0.0;
+    }
+  // one line: pages, ratio and the mean time per page each way
+  void print(std::ostream& os, const char* name) const;
+};
+
+
+// Per-file counters, kept by the buffer manager (the first group) and
+// by File itself (the latencies).
+
+struct FileStats
+{
+  Counter accesses;                  // readPage and allocPage calls
+  Counter hits;                      // accesses that found the page resident
+  Counter misses;                    // accesses that had to read the page
+  Counter diskreads;                 // pages read, read-ahead included
+  Counter diskwrites;                // dirty pages written back
+  Counter evictions;                 // pages of the file replaced in the pool
+  Counter bufferExceeded;            // accesses failed with BUFFEREXCEEDED
+
+  LatencyHistogram readLatency;	     // File::intread
+  LatencyHistogram writeLatency;     // File::intwrite
+  LatencyHistogram batchLatency;     // File::readPages/writePages, per batch
+  CodecStats compression;	     // pages stored compressed, DB_COMPRESS
+
+  FileStats() { clear(); }
+  void clear();
+  double hitRatio() const
+    {
+      return accesses > 0 ? (double)hits / accesses : 0.0;
+    }
+  void print(std::ostream& os) const;
+};
+
+
+// Ring buffer of the most recent buffer pool events.  Writers claim a
+// slot with one fetch_add; the oldest events are overwritten.  dump()
+// writes the events in order as text, one per line:
+//
+//     <fileId> <pageNo> <event> <frame>
+//
+// where event is H (hit), M (miss), A (allocPage), E (eviction) or D
+// (unpinned dirty).  Events overwritten while the dump runs are left out.
+
+enum TraceEvent { TRACE_HIT, TRACE_MISS, TRACE_ALLOC, TRACE_EVICT,
+		  TRACE_DIRTY };
+
+class AccessTrace
+{
+public:
+  AccessTrace(const int capacity); // rounded up to a power of two
+  ~AccessTrace();
+
+  void record(const int fileId, const int pageNo, const TraceEvent event,
+	      const int frame);
+  long long recorded() const { return next.load(std::memory_order_relaxed); }
+  long long lost() const;	// recorded, but overwritten since
+  const Status dump(const char* path) const;
+
+private:
+  // two words per event: fileId and pageNo; sequence, frame and event
+  std::atomic<unsigned long long>* words;
+  unsigned long long mask;
+  std::atomic<unsigned long long> next;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef ZCACHE_H
+#define ZCACHE_H
+
+#include <stddef.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "stats.h"
+
+class File;
+class Page;
+
+// Second tier of the buffer pool: pages evicted from their frames, kept
+// compressed (see lz.h) in up to capacity bytes of heap.  When that is
+// full the page stored longest ago goes first.  A miss that finds its
+// page here decompresses it instead of reading the disk.
+//
+// The buffer manager only stores pages that are clean, written back
+// first if need be, so the tier never holds the only copy of a change
+// and an entry can be dropped at any time.  A page is taken out when it
+// is read back into a frame, and the buffer manager removes the entries
+// of pages disposed of or reallocated, and of files being closed.
+
+class CompressedCache
+{
+public:
+  CompressedCache(const size_t capacity);
+
+  // Store a page compressed by packPage(), length bytes of packed, as
+  // (file,pageNo), replacing any entry there.  A length of 0, a page
+  // that did not compress, just drops the entry.
+  void put(const File* file, const int pageNo, const char* packed,
+	   const int length);
+
+  // Decompress (file,pageNo) into page and drop the entry.  Returns
+  // false if it is not here.
+  bool take(const File* file, const int pageNo, Page* page,
+	    CodecStats& stats);
+
+  bool contains(const File* file, const int pageNo) const;
+  void remove(const File* file, const int pageNo);
+  void removeFile(const File* file);	// all pages of file
+
+  size_t bytes() const;			// held now, bookkeeping included
+  int	 pages() const;
+
+private:
+  struct Entry {
+    const File*	      file;
+    int		      pageNo;
+    std::vector<char> data;		// the compressed page
+  };
+  struct Key {
+    const File* file;
+    int		pageNo;
+    bool operator == (const Key& other) const
+      {
+	return file == other.file && pageNo == other.pageNo;
+      }
+  };
+  struct KeyHash {
+    size_t operator () (const Key& key) const
+      {
+	return (size_t)key.file ^ ((size_t)(unsigned)key.pageNo * 0x9e3779b97f4a7c15ULL);
+      }
+  };
+  typedef std::list<Entry>::iterator Position;
+
+  mutable std::mutex latch;		// protects the fields below
+  std::list<Entry> lru;			// most recently stored first
+  std::unordered_map<Key, Position, KeyHash> index;
+  size_t capacity;
+  size_t used;				// bytes held, see entryBytes()
+
+  static size_t entryBytes(const Entry& entry)
+    {
+      return entry.data.size() + sizeof(Entry) + 4 * sizeof(void*);
+    }
+  void erase(Position pos);		// caller holds latch
+};
+
+#endif